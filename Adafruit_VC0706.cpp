@@ -16,6 +16,50 @@
 
 #include "Adafruit_VC0706.h"
 
+// readPicture() JPEG parser states
+enum {
+  JPEG_SOI,       // expecting FF D8
+  JPEG_SOI2,      // second SOI byte
+  JPEG_MARKER,    // expecting FF before the next header segment
+  JPEG_MARKERID,  // marker type
+  JPEG_LEN,       // segment length, high byte
+  JPEG_LEN2,      // segment length, low byte
+  JPEG_SKIP,      // segment payload
+  JPEG_ENTROPY,   // scan data
+  JPEG_ENTROPYFF, // scan data after an FF
+};
+
+// Adler-32 sums over n bytes, without the modulo: callers reduce them
+// after every chunk of at most 255 bytes, so they can't overflow
+static void adlerUpdate(uint32_t &a, uint32_t &b, const uint8_t *p,
+                        uint8_t n) {
+#if defined(VC0706_VECTOR_SIGNATURE)
+  // host builds: 16 bytes at a time with GCC/clang vector extensions,
+  // using b += 16 * a + sum((16 - i) * p[i]) and a += sum(p[i])
+  typedef uint8_t v16u8 __attribute__((vector_size(16)));
+  typedef uint16_t v16u16 __attribute__((vector_size(32)));
+  const v16u16 weight = {16, 15, 14, 13, 12, 11, 10, 9,
+                         8,  7,  6,  5,  4,  3,  2,  1};
+  for (; n >= 16; n -= 16, p += 16) {
+    v16u8 x;
+    memcpy(&x, p, sizeof(x));
+    v16u16 wide = __builtin_convertvector(x, v16u16);
+    v16u16 weighted = wide * weight;
+    uint32_t sum = 0, wsum = 0;
+    for (uint8_t i = 0; i < 16; i++) {
+      sum += wide[i];
+      wsum += weighted[i];
+    }
+    b += 16 * a + wsum;
+    a += sum;
+  }
+#endif
+  for (uint8_t i = 0; i < n; i++) {
+    a += p[i];
+    b += a;
+  }
+}
+
 // Initialization code used by all constructor types
 void Adafruit_VC0706::common_init(void) {
 #if defined(__AVR__) || defined(ESP8266)
@@ -23,8 +67,20 @@ void Adafruit_VC0706::common_init(void) {
 #endif
   hwSerial = NULL;
   frameptr = 0;
+  framelen = 0;
+  reflen = refsig = 0;
+  similarity = 0;
+  sigspan = VC0706_SIGBYTES;
   bufferLen = 0;
   serialNum = 0;
+  armed = false;
+  memset(&timing, 0, sizeof(timing));
+  resetPicture();
+  picturelen = 0;
+  jpegsos = false;
+  jpegskip = 0;
+  tracebuf = NULL;
+  tracesize = tracehead = tracecount = 0;
 }
 
 #if defined(__AVR__) || defined(ESP8266)
@@ -458,10 +514,112 @@ boolean Adafruit_VC0706::getPTZ(uint16_t &w, uint16_t &h, uint16_t &wz,
 */
 /**************************************************************************/
 boolean Adafruit_VC0706::takePicture() {
-  frameptr = 0;
+  resetPicture();
   return cameraFrameBuffCtrl(VC0706_STOPCURRENTFRAME);
 }
 
+/**************************************************************************/
+/*!
+    @brief Prepare for a low-lag triggerPicture(). The STOPCURRENTFRAME
+    packet is built ahead of time and any stale bytes are drained from
+    the serial port now, so the trigger itself only has to write 5 bytes.
+*/
+/**************************************************************************/
+void Adafruit_VC0706::armPicture(void) {
+  armcmd[0] = 0x56;
+  armcmd[1] = serialNum;
+  armcmd[2] = VC0706_FBUF_CTRL;
+  armcmd[3] = 0x1;
+  armcmd[4] = VC0706_STOPCURRENTFRAME;
+
+  // flush out anything in the buffer
+  readResponse(CAMERABUFFSIZ, CAMERADELAY);
+  armed = true;
+}
+
+/**************************************************************************/
+/*!
+    @brief Freeze the current frame using the packet prepared by
+    armPicture(), recording timestamps along the way (see
+    getCaptureTiming()). The ack is busy-polled rather than read with
+    readResponse(), which sleeps 1 ms between checks, so its timestamp
+    is as fine as micros().
+    @returns True on command success, false if not armed
+*/
+/**************************************************************************/
+boolean Adafruit_VC0706::triggerPicture(void) {
+  timing.trigger = micros();
+  timing.sent = timing.ack = timing.done = 0;
+  if (!armed)
+    return false;
+  armed = false;
+
+  // one write unless tracing, which stamps each byte as it's written
+#if defined(__AVR__) || defined(ESP8266)
+  if (swSerial) {
+    if (!tracebuf) {
+      swSerial->write(armcmd, sizeof(armcmd)); // blocks until sent
+    } else {
+      for (uint8_t i = 0; i < sizeof(armcmd); i++) {
+        swSerial->write(armcmd[i]);
+        traceByte(VC0706_TRACE_TX, armcmd[i]);
+      }
+    }
+  } else
+#endif
+  {
+    if (!tracebuf) {
+      hwSerial->write(armcmd, sizeof(armcmd));
+    } else {
+      for (uint8_t i = 0; i < sizeof(armcmd); i++) {
+        hwSerial->write(armcmd[i]);
+        traceByte(VC0706_TRACE_TX, armcmd[i]);
+      }
+    }
+    hwSerial->flush(); // wait for the TX buffer to drain
+  }
+  timing.sent = micros();
+
+  resetPicture();
+  bufferLen = 0;
+  while (bufferLen < 5) {
+    int avail;
+#if defined(__AVR__) || defined(ESP8266)
+    avail = swSerial ? swSerial->available() : hwSerial->available();
+#else
+    avail = hwSerial->available();
+#endif
+    if (avail <= 0) {
+      if (micros() - timing.sent > 200000UL)
+        return false;
+      continue;
+    }
+#if defined(__AVR__) || defined(ESP8266)
+    camerabuff[bufferLen++] = swSerial ? swSerial->read() : hwSerial->read();
+#else
+    camerabuff[bufferLen++] = hwSerial->read();
+#endif
+    traceByte(VC0706_TRACE_RX, camerabuff[bufferLen - 1]);
+  }
+  uint32_t ack = micros();
+  if (!verifyResponse(VC0706_FBUF_CTRL))
+    return false;
+  timing.ack = ack;
+  return true;
+}
+
+/**************************************************************************/
+/*!
+    @brief Get the timestamps from the last triggerPicture(). 'done' is
+    filled in once readPicture() finds the end of the image, or has read
+    frameLength() bytes.
+    @returns Copy of the capture timestamps, in micros()
+*/
+/**************************************************************************/
+VC0706_CaptureTiming Adafruit_VC0706::getCaptureTiming(void) {
+  return timing;
+}
+
 /**************************************************************************/
 /*!
     @brief Send RESUMEFRAME command
@@ -526,9 +684,100 @@ uint32_t Adafruit_VC0706::frameLength(void) {
   len <<= 8;
   len |= camerabuff[8];
 
+  framelen = len;
   return len;
 }
 
+/**************************************************************************/
+/*!
+    @brief Set how close a frame's length must be to the last kept frame
+    for frameUnchanged() to call it a repeat
+    @param permille Allowed length difference in 1/1000ths of the last
+    kept frame's length (at most 1000), 0 turns the check off
+*/
+/**************************************************************************/
+void Adafruit_VC0706::setFrameSimilarity(uint16_t permille) {
+  similarity = (permille > 1000) ? 1000 : permille;
+}
+
+/**************************************************************************/
+/*!
+    @brief Set how much of the scan scanSignature() covers. Scan data runs
+    left to right, top to bottom in 16x8 pixel blocks, and at the VC0706's
+    compression the default VC0706_SIGBYTES only spans the first few
+    blocks in the top-left corner. A bigger span covers more of the
+    picture, but the signature is only ready once that much has been read.
+    @param bytes Scan bytes to cover, 0 for the whole first scan, which
+    for the VC0706's baseline JPEGs is the whole image
+*/
+/**************************************************************************/
+void Adafruit_VC0706::setScanSignatureBytes(uint32_t bytes) {
+  sigspan = bytes;
+}
+
+/**************************************************************************/
+/*!
+    @brief Check whether a frame is a near-repeat of the last kept frame,
+    using only its compressed length so no READ_FBUF transfer is needed.
+    Scene changes move the JPEG size a lot more than sensor noise does.
+    This only compares, call keepFrame() once a frame has been stored.
+    @param len Frame length, as returned by frameLength()
+    @returns True if the frame can be skipped
+*/
+/**************************************************************************/
+boolean Adafruit_VC0706::frameUnchanged(uint32_t len) {
+  if (!similarity || !reflen || !len)
+    return false;
+
+  uint32_t diff = (len > reflen) ? (len - reflen) : (reflen - len);
+  return diff * 1000 <= reflen * similarity;
+}
+
+/**************************************************************************/
+/*!
+    @brief Make a frame the reference for frameUnchanged() and
+    scanUnchanged(), once it has actually been transferred and kept
+    @param len Frame length, as returned by frameLength(). 0 is ignored.
+*/
+/**************************************************************************/
+void Adafruit_VC0706::keepFrame(uint32_t len) {
+  if (len)
+    reflen = len;
+  if (scanSignature())
+    refsig = scanSignature();
+}
+
+/**************************************************************************/
+/*!
+    @brief Get the Adler-32 of the start of the scan data, as much of it
+    as setScanSignatureBytes() asks for, or all of it once the end of
+    the first scan has been read. It's built up by readPicture() as the data
+    goes past. Being an exact checksum, any change in the part of the
+    picture it covers alters it, sensor noise included, and changes
+    outside that part don't.
+    @returns The signature, or 0 until enough scan data has been read
+*/
+/**************************************************************************/
+uint32_t Adafruit_VC0706::scanSignature(void) {
+  if (!sigfull && (!sigspan || (sigcount < sigspan)))
+    return 0;
+  return (sigb << 16) | siga;
+}
+
+/**************************************************************************/
+/*!
+    @brief Check the start of the scan against the last kept frame. Once
+    scanSignature() is ready, a caller that got a frameUnchanged() can
+    use this to abort the rest of the transfer; a frame with the same
+    size but a change in the part of the picture the signature covers
+    fails here.
+    @returns True if the scan starts the same as the last kept frame's
+*/
+/**************************************************************************/
+boolean Adafruit_VC0706::scanUnchanged(void) {
+  return refsig && (scanSignature() == refsig);
+}
+
 /**************************************************************************/
 /*!
     @brief Get available bytes to read
@@ -539,7 +788,8 @@ uint8_t Adafruit_VC0706::available(void) { return bufferLen; }
 
 /**************************************************************************/
 /*!
-    @brief Read in picture data
+    @brief Read in picture data. The JPEG structure is checked as it
+    comes in, see pictureStatus().
     @param n Number of bytes
     @returns Pointer to buffer containing n bytes of picture data
 */
@@ -563,14 +813,94 @@ uint8_t *Adafruit_VC0706::readPicture(uint8_t n) {
     return 0;
 
   // read into the buffer PACKETLEN!
-  if (readResponse(n + 5, CAMERADELAY) == 0)
+  uint8_t got = readResponse(n + 5, CAMERADELAY);
+  if (got == 0)
     return 0;
 
+  parseJPEG((got < n) ? got : n);
   frameptr += n;
 
+  if ((jpegstatus == VC0706_JPEG_RUNNING) &&
+      ((got < n) || (framelen && (frameptr >= framelen))))
+    jpegstatus = VC0706_JPEG_TRUNCATED;
+  if ((jpegstatus != VC0706_JPEG_RUNNING) && !timing.done)
+    timing.done = micros();
+
   return camerabuff;
 }
 
+/**************************************************************************/
+/*!
+    @brief Check how the current picture transfer is going. Once this is
+    no longer VC0706_JPEG_RUNNING there is no point reading any further:
+    either the whole image is in, or the frame is bad and should be
+    taken again.
+    @returns VC0706_JPEG_RUNNING, VC0706_JPEG_COMPLETE, VC0706_JPEG_CORRUPT
+    or VC0706_JPEG_TRUNCATED
+*/
+/**************************************************************************/
+uint8_t Adafruit_VC0706::pictureStatus(void) { return jpegstatus; }
+
+/**************************************************************************/
+/*!
+    @brief Get how much of the last readPicture() buffer is image data,
+    which is less than was asked for when it held the end of the image
+    @returns Byte count
+*/
+/**************************************************************************/
+uint8_t Adafruit_VC0706::pictureBytes(void) { return picturelen; }
+
+/**************************************************************************/
+/*!
+    @brief Record every byte sent and received into a ring buffer, oldest
+    records are overwritten once it fills up. Calling this again clears
+    the trace. Each byte is stamped right after its write() or read(),
+    which for SoftwareSerial is when it has gone out on the wire and for
+    hardware serial when it has been queued.
+    @param buf Buffer for len records, or NULL to stop tracing
+    @param len Number of records buf can hold
+*/
+/**************************************************************************/
+void Adafruit_VC0706::setTrace(VC0706_TraceRecord *buf, size_t len) {
+  tracebuf = len ? buf : NULL;
+  tracesize = len;
+  tracehead = tracecount = 0;
+}
+
+/**************************************************************************/
+/*!
+    @brief Get the number of records in the trace buffer
+    @returns Record count
+*/
+/**************************************************************************/
+size_t Adafruit_VC0706::traceLength(void) { return tracecount; }
+
+/**************************************************************************/
+/*!
+    @brief Write the trace out, oldest record first, e.g. to an SD file.
+    The format is "VCT1" followed by 6 bytes per record: time as a little
+    endian uint32_t, then dir and data.
+    @param out Where to write it
+    @returns Number of records written
+*/
+/**************************************************************************/
+size_t Adafruit_VC0706::dumpTrace(Print &out) {
+  out.write((const uint8_t *)"VCT1", 4);
+
+  size_t i = (tracecount < tracesize) ? 0 : tracehead; // oldest record
+  for (size_t n = 0; n < tracecount; n++) {
+    VC0706_TraceRecord &r = tracebuf[i];
+    uint8_t rec[] = {(uint8_t)r.time,         (uint8_t)(r.time >> 8),
+                     (uint8_t)(r.time >> 16), (uint8_t)(r.time >> 24),
+                     r.dir,                   r.data};
+    if (out.write(rec, sizeof(rec)) != sizeof(rec))
+      return n;
+    if (++i == tracesize)
+      i = 0;
+  }
+  return tracecount;
+}
+
 /**************** low level commands */
 
 boolean Adafruit_VC0706::runCommand(uint8_t cmd, uint8_t *args, uint8_t argn,
@@ -594,28 +924,31 @@ void Adafruit_VC0706::sendCommand(uint8_t cmd, uint8_t args[] = 0,
   if (swSerial) {
 
     swSerial->write((byte)0x56);
+    traceByte(VC0706_TRACE_TX, 0x56);
     swSerial->write((byte)serialNum);
+    traceByte(VC0706_TRACE_TX, serialNum);
     swSerial->write((byte)cmd);
+    traceByte(VC0706_TRACE_TX, cmd);
 
     for (uint8_t i = 0; i < argn; i++) {
       swSerial->write((byte)args[i]);
-      // Serial.print(" 0x");
-      // Serial.print(args[i], HEX);
+      traceByte(VC0706_TRACE_TX, args[i]);
     }
   } else
 #endif
   {
     hwSerial->write((byte)0x56);
+    traceByte(VC0706_TRACE_TX, 0x56);
     hwSerial->write((byte)serialNum);
+    traceByte(VC0706_TRACE_TX, serialNum);
     hwSerial->write((byte)cmd);
+    traceByte(VC0706_TRACE_TX, cmd);
 
     for (uint8_t i = 0; i < argn; i++) {
       hwSerial->write((byte)args[i]);
-      // Serial.print(" 0x");
-      // Serial.print(args[i], HEX);
+      traceByte(VC0706_TRACE_TX, args[i]);
     }
   }
-  // Serial.println();
 }
 
 uint8_t Adafruit_VC0706::readResponse(uint8_t numbytes, uint8_t timeout) {
@@ -641,10 +974,8 @@ uint8_t Adafruit_VC0706::readResponse(uint8_t numbytes, uint8_t timeout) {
 #else
     camerabuff[bufferLen++] = hwSerial->read();
 #endif
+    traceByte(VC0706_TRACE_RX, camerabuff[bufferLen - 1]);
   }
-  // printBuff();
-  // camerabuff[bufferLen] = 0;
-  // Serial.println((char*)camerabuff);
   return bufferLen;
 }
 
@@ -655,6 +986,119 @@ boolean Adafruit_VC0706::verifyResponse(uint8_t command) {
   return true;
 }
 
+void Adafruit_VC0706::traceByte(uint8_t dir, uint8_t data) {
+  if (!tracebuf)
+    return;
+  VC0706_TraceRecord &r = tracebuf[tracehead];
+  r.time = micros();
+  r.dir = dir;
+  r.data = data;
+  if (++tracehead == tracesize)
+    tracehead = 0;
+  if (tracecount < tracesize)
+    tracecount++;
+}
+
+void Adafruit_VC0706::resetPicture(void) {
+  frameptr = 0;
+  framelen = 0; // set again by frameLength()
+  jpegstatus = VC0706_JPEG_RUNNING;
+  jpegparse = JPEG_SOI;
+  siga = 1;
+  sigb = 0;
+  sigcount = 0;
+  sigfull = false;
+}
+
+void Adafruit_VC0706::parseJPEG(uint8_t n) {
+  int16_t scan = -1;    // where first scan data starts in this chunk
+  int16_t scanend = -1; // and where it ends
+
+  // nothing past the end of the image, or a corrupt one, is image data
+  picturelen = (jpegstatus == VC0706_JPEG_RUNNING) ? n : 0;
+  for (uint8_t i = 0; (i < n) && (jpegstatus == VC0706_JPEG_RUNNING); i++) {
+    uint8_t b = camerabuff[i];
+
+    if ((scan < 0) && !sigfull &&
+        ((jpegparse == JPEG_ENTROPY) || (jpegparse == JPEG_ENTROPYFF)))
+      scan = i;
+
+    switch (jpegparse) {
+    case JPEG_SOI:
+      if (b != 0xFF)
+        jpegstatus = VC0706_JPEG_CORRUPT;
+      jpegparse = JPEG_SOI2;
+      break;
+    case JPEG_MARKER:
+      if (b != 0xFF)
+        jpegstatus = VC0706_JPEG_CORRUPT;
+      jpegparse = JPEG_MARKERID;
+      break;
+    case JPEG_SOI2:
+      if (b != 0xD8)
+        jpegstatus = VC0706_JPEG_CORRUPT;
+      jpegparse = JPEG_MARKER;
+      break;
+    case JPEG_ENTROPY:
+      if (b == 0xFF)
+        jpegparse = JPEG_ENTROPYFF;
+      break;
+    case JPEG_ENTROPYFF:
+      if ((b == 0x00) || ((b >= 0xD0) && (b <= 0xD7))) {
+        // stuffed FF or restart marker, still scan data
+        jpegparse = JPEG_ENTROPY;
+        break;
+      }
+      if (!sigfull) { // the marker's FF isn't scan data
+        sigfull = true;
+        scanend = i ? i - 1 : 0;
+      }
+      // fall through - any other marker ends the scan
+    case JPEG_MARKERID:
+      if (b == 0xFF) // fill byte
+        break;
+      if (b == 0xD9) {
+        jpegstatus = VC0706_JPEG_COMPLETE;
+        picturelen = i + 1;
+        break;
+      }
+      jpegsos = (b == 0xDA);
+      jpegparse = JPEG_LEN;
+      break;
+    case JPEG_LEN:
+      jpegskip = b;
+      jpegparse = JPEG_LEN2;
+      break;
+    case JPEG_LEN2:
+      jpegskip = (jpegskip << 8) | b;
+      if (jpegskip < 2) {
+        jpegstatus = VC0706_JPEG_CORRUPT;
+        break;
+      }
+      jpegskip -= 2; // the length includes itself
+      jpegparse = JPEG_SKIP;
+      if (jpegskip)
+        break;
+      // fall through - empty segment
+    case JPEG_SKIP:
+      if (jpegskip && --jpegskip)
+        break;
+      jpegparse = jpegsos ? JPEG_ENTROPY : JPEG_MARKER;
+      break;
+    }
+  }
+
+  if ((scan >= 0) && (!sigspan || (sigcount < sigspan))) {
+    uint8_t m = ((scanend >= 0) ? scanend : picturelen) - scan;
+    if (sigspan && (m > sigspan - sigcount))
+      m = sigspan - sigcount;
+    adlerUpdate(siga, sigb, camerabuff + scan, m);
+    siga %= 65521;
+    sigb %= 65521;
+    sigcount += m;
+  }
+}
+
 void Adafruit_VC0706::printBuff() {
   for (uint8_t i = 0; i < bufferLen; i++) {
     Serial.print(" 0x");
@@ -63,6 +63,40 @@
 #define CAMERABUFFSIZ 100
 #define CAMERADELAY 10
 
+/**************************************************************************/
+/*!
+    @brief micros() timestamps recorded by armPicture()/triggerPicture()
+*/
+/**************************************************************************/
+typedef struct {
+  uint32_t trigger; ///< triggerPicture() was called
+  uint32_t sent;    ///< STOPCURRENTFRAME finished going out the UART
+  uint32_t ack;     ///< Camera acknowledged the frame freeze
+  uint32_t done;    ///< Last byte of the frozen frame was read back
+} VC0706_CaptureTiming;
+
+#define VC0706_JPEG_RUNNING 0   // transfer in progress, no errors so far
+#define VC0706_JPEG_COMPLETE 1  // end of image marker seen
+#define VC0706_JPEG_CORRUPT 2   // not a JPEG, or broken marker structure
+#define VC0706_JPEG_TRUNCATED 3 // data ran out before the end of image
+
+// default scan bytes covered by scanSignature()
+#define VC0706_SIGBYTES 64
+
+#define VC0706_TRACE_TX 0x00 // byte sent to the camera
+#define VC0706_TRACE_RX 0x01 // byte received from the camera
+
+/**************************************************************************/
+/*!
+    @brief One byte on the wire, see setTrace()
+*/
+/**************************************************************************/
+typedef struct {
+  uint32_t time; ///< micros() right after the byte's write()/read()
+  uint8_t dir;   ///< VC0706_TRACE_TX or VC0706_TRACE_RX
+  uint8_t data;  ///< The byte itself
+} VC0706_TraceRecord;
+
 /**************************************************************************/
 /*!
     @brief Class for communicating with VC0706 cameras
@@ -79,9 +113,20 @@ public:
   boolean TVon(void);
   boolean TVoff(void);
   boolean takePicture(void);
+  void armPicture(void);
+  boolean triggerPicture(void);
+  VC0706_CaptureTiming getCaptureTiming(void);
   uint8_t *readPicture(uint8_t n);
+  uint8_t pictureStatus(void);
+  uint8_t pictureBytes(void);
   boolean resumeVideo(void);
   uint32_t frameLength(void);
+  void setFrameSimilarity(uint16_t permille);
+  void setScanSignatureBytes(uint32_t bytes);
+  boolean frameUnchanged(uint32_t len);
+  void keepFrame(uint32_t len);
+  uint32_t scanSignature(void);
+  boolean scanUnchanged(void);
   char *getVersion(void);
   uint8_t available();
   uint8_t getDownsize(void);
@@ -101,6 +146,10 @@ public:
                  uint16_t &pan, uint16_t &tilt);
   boolean setPTZ(uint16_t wz, uint16_t hz, uint16_t pan, uint16_t tilt);
 
+  void setTrace(VC0706_TraceRecord *buf, size_t len);
+  size_t traceLength(void);
+  size_t dumpTrace(Print &out);
+
   void OSD(uint8_t x, uint8_t y, char *s); // isnt supported by the chip :(
 
   char *setBaud9600();
@@ -114,6 +163,20 @@ private:
   uint8_t camerabuff[CAMERABUFFSIZ + 1];
   uint8_t bufferLen;
   uint32_t frameptr;
+  uint32_t framelen;
+  uint32_t reflen, refsig;
+  uint32_t siga, sigb;
+  uint32_t sigcount, sigspan;
+  boolean sigfull;
+  uint16_t similarity;
+  uint8_t armcmd[5];
+  boolean armed;
+  VC0706_CaptureTiming timing;
+  uint8_t jpegstatus, jpegparse, picturelen;
+  boolean jpegsos;
+  uint16_t jpegskip;
+  VC0706_TraceRecord *tracebuf;
+  size_t tracesize, tracehead, tracecount;
 
 #if defined(__AVR__) || defined(ESP8266)
   SoftwareSerial *swSerial;
@@ -126,5 +189,8 @@ private:
   void sendCommand(uint8_t cmd, uint8_t args[], uint8_t argn);
   uint8_t readResponse(uint8_t numbytes, uint8_t timeout);
   boolean verifyResponse(uint8_t command);
+  void traceByte(uint8_t dir, uint8_t data);
+  void resetPicture(void);
+  void parseJPEG(uint8_t n);
   void printBuff(void);
 };
@@ -175,13 +175,18 @@ void loop() {
     uint8_t *buffer;
     uint8_t bytesToRead = min((uint32_t)32, jpglen); // change 32 to 64 for a speedup but may not work with all setups!
     buffer = cam.readPicture(bytesToRead);
-    imgFile.write(buffer, bytesToRead);
+    if (buffer == 0) break;
+    imgFile.write(buffer, cam.pictureBytes()); // stops short at the end of the image
 
     //Serial.print("Read ");  Serial.print(bytesToRead, DEC); Serial.println(" bytes");
 
     jpglen -= bytesToRead;
+    // Done as soon as the end of the JPEG turns up, or it's found to be bad
+    if (cam.pictureStatus() != VC0706_JPEG_RUNNING) break;
   }
   imgFile.close();
+  if (cam.pictureStatus() != VC0706_JPEG_COMPLETE)
+    Serial.println("Image is corrupt or incomplete!");
   Serial.println("...Done!");
   cam.resumeVideo();
   cam.setMotionDetect(true);
@@ -161,15 +161,20 @@ void setup() {
     uint8_t *buffer;
     uint8_t bytesToRead = min((uint32_t)32, jpglen); // change 32 to 64 for a speedup but may not work with all setups!
     buffer = cam.readPicture(bytesToRead);
-    imgFile.write(buffer, bytesToRead);
+    if (buffer == 0) break;
+    imgFile.write(buffer, cam.pictureBytes()); // stops short at the end of the image
     if(++wCount >= 64) { // Every 2K, give a little feedback so it doesn't appear locked up
       Serial.print('.');
       wCount = 0;
     }
     //Serial.print("Read ");  Serial.print(bytesToRead, DEC); Serial.println(" bytes");
     jpglen -= bytesToRead;
+    // Done as soon as the end of the JPEG turns up, or it's found to be bad
+    if (cam.pictureStatus() != VC0706_JPEG_RUNNING) break;
   }
   imgFile.close();
+  if (cam.pictureStatus() != VC0706_JPEG_COMPLETE)
+    Serial.println("Image is corrupt or incomplete!");
 
   time = millis() - time;
   Serial.println("done!");
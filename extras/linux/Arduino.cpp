@@ -0,0 +1,85 @@
+/***************************************************
+  Minimal Arduino API for building the Adafruit_VC0706 driver on Linux
+
+  BSD license, all text above must be included in any redistribution
+ ****************************************************/
+
+#include "Arduino.h"
+
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+static uint64_t monotonicMicros(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static boolean virtualClock = false;
+static uint64_t virtualMicros;
+
+void useVirtualClock(boolean on) {
+  virtualClock = on;
+  virtualMicros = 0;
+}
+
+void advanceClock(uint32_t us) { virtualMicros += us; }
+
+static uint64_t now(void) {
+  return virtualClock ? virtualMicros : monotonicMicros();
+}
+
+uint32_t millis(void) { return (uint32_t)(now() / 1000); }
+
+uint32_t micros(void) { return (uint32_t)now(); }
+
+uint64_t micros64(void) { return now(); }
+
+void delay(uint32_t ms) {
+  if (virtualClock)
+    advanceClock(ms * 1000);
+  else
+    usleep(ms * 1000);
+}
+
+size_t Print::write(const uint8_t *buf, size_t len) {
+  size_t n = 0;
+  while ((n < len) && write(buf[n]))
+    n++;
+  return n;
+}
+
+void Print::print(const char *s) {
+  write((const uint8_t *)s, strlen(s));
+}
+
+void Print::print(unsigned int n, int base) {
+  char s[16];
+  snprintf(s, sizeof(s), (base == HEX) ? "%X" : "%u", n);
+  print(s);
+}
+
+void Print::println(void) { print("\n"); }
+
+void Print::println(const char *s) {
+  print(s);
+  println();
+}
+
+/**************************************************************************/
+/*!
+    @brief Console output on stderr, so stdout stays free for data
+*/
+/**************************************************************************/
+class ConsoleSerial : public HardwareSerial {
+public:
+  void begin(uint32_t) {}
+  int available(void) { return 0; }
+  int read(void) { return -1; }
+  using Print::write;
+  size_t write(uint8_t b) { return fwrite(&b, 1, 1, stderr); }
+};
+
+static ConsoleSerial console;
+HardwareSerial &Serial = console;
@@ -0,0 +1,69 @@
+/***************************************************
+  Minimal Arduino API for building the Adafruit_VC0706 driver on Linux
+
+  Only what the driver uses is provided: the integer types, timing
+  calls, Print and a HardwareSerial base class that ports subclass.
+
+  BSD license, all text above must be included in any redistribution
+ ****************************************************/
+
+#ifndef _VC0706_LINUX_ARDUINO_H
+#define _VC0706_LINUX_ARDUINO_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define DEC 10
+#define HEX 16
+
+uint32_t millis(void);
+uint32_t micros(void);
+void delay(uint32_t ms);
+
+// Host only: simulated time for running against a model of the camera.
+// Once enabled the clock starts at 0 and only moves by delay() or
+// advanceClock(), so runs are repeatable and don't wait on real time.
+void useVirtualClock(boolean on);
+void advanceClock(uint32_t us);
+// Host only: micros() without the wrap after 71 minutes
+uint64_t micros64(void);
+
+/**************************************************************************/
+/*!
+    @brief Byte sink, as in the Arduino core
+*/
+/**************************************************************************/
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t b) = 0;
+  virtual size_t write(const uint8_t *buf, size_t len);
+
+  void print(const char *s);
+  void print(unsigned int n, int base = DEC);
+  void println(void);
+  void println(const char *s);
+};
+
+/**************************************************************************/
+/*!
+    @brief Byte stream interface the driver talks to. Subclasses provide
+    the actual transport (a tty, a recorded trace, a simulated camera...)
+*/
+/**************************************************************************/
+class HardwareSerial : public Print {
+public:
+  using Print::write;
+  virtual void begin(uint32_t baud) = 0;
+  virtual int available(void) = 0;
+  virtual int read(void) = 0;
+  virtual void flush(void) {}
+};
+
+extern HardwareSerial &Serial; // console, used by printBuff()
+
+#endif
@@ -0,0 +1,115 @@
+/***************************************************
+  tty transport for using the Adafruit_VC0706 driver on Linux hosts
+
+  BSD license, all text above must be included in any redistribution
+ ****************************************************/
+
+#include "LinuxSerial.h"
+
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
+
+/**************************************************************************/
+/*!
+    @brief Open the tty, it is configured later by begin()
+    @param path Device path
+*/
+/**************************************************************************/
+LinuxSerial::LinuxSerial(const char *path) {
+  // don't hang waiting for carrier detect, but do block on I/O after that
+  fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+  if (fd >= 0)
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+}
+
+LinuxSerial::~LinuxSerial() {
+  if (fd >= 0)
+    close(fd);
+}
+
+static speed_t baudToSpeed(uint32_t baud) {
+  switch (baud) {
+  case 9600:
+    return B9600;
+  case 19200:
+    return B19200;
+  case 38400:
+    return B38400;
+  case 57600:
+    return B57600;
+  case 115200:
+    return B115200;
+  default:
+    return B0;
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief Check for one of the rates the camera can be set to
+    @param baud Baud rate
+    @return True for 9600, 19200, 38400, 57600 or 115200
+*/
+/**************************************************************************/
+boolean LinuxSerial::supportsBaud(uint32_t baud) {
+  return baudToSpeed(baud) != B0;
+}
+
+/**************************************************************************/
+/*!
+    @brief Switch the tty to raw 8N1 at the given rate. Unsupported rates
+    (see supportsBaud()) leave the tty as it was.
+    @param baud 9600, 19200, 38400, 57600 or 115200
+*/
+/**************************************************************************/
+void LinuxSerial::begin(uint32_t baud) {
+  struct termios tio;
+  if ((fd < 0) || !supportsBaud(baud) || (tcgetattr(fd, &tio) != 0))
+    return;
+  cfmakeraw(&tio);
+  tio.c_cflag |= CLOCAL | CREAD;
+  tio.c_cflag &= ~(CSTOPB | CRTSCTS);
+  cfsetispeed(&tio, baudToSpeed(baud));
+  cfsetospeed(&tio, baudToSpeed(baud));
+  tcsetattr(fd, TCSANOW, &tio);
+  tcflush(fd, TCIOFLUSH);
+}
+
+int LinuxSerial::available(void) {
+  int n = 0;
+  if ((fd < 0) || (ioctl(fd, FIONREAD, &n) != 0))
+    return 0;
+  return n;
+}
+
+int LinuxSerial::read(void) {
+  uint8_t b;
+  if ((fd < 0) || (::read(fd, &b, 1) != 1))
+    return -1;
+  return b;
+}
+
+size_t LinuxSerial::write(uint8_t b) { return write(&b, 1); }
+
+size_t LinuxSerial::write(const uint8_t *buf, size_t len) {
+  size_t n = 0;
+  while ((fd >= 0) && (n < len)) {
+    ssize_t r = ::write(fd, buf + n, len - n);
+    if (r < 0)
+      break;
+    n += r;
+  }
+  return n;
+}
+
+/**************************************************************************/
+/*!
+    @brief Wait until everything written has left the UART
+*/
+/**************************************************************************/
+void LinuxSerial::flush(void) {
+  if (fd >= 0)
+    tcdrain(fd);
+}
@@ -0,0 +1,34 @@
+/***************************************************
+  tty transport for using the Adafruit_VC0706 driver on Linux hosts
+
+  BSD license, all text above must be included in any redistribution
+ ****************************************************/
+
+#ifndef _VC0706_LINUX_SERIAL_H
+#define _VC0706_LINUX_SERIAL_H
+
+#include "Arduino.h"
+
+/**************************************************************************/
+/*!
+    @brief HardwareSerial on top of a raw-mode tty such as /dev/ttyAMA0
+*/
+/**************************************************************************/
+class LinuxSerial : public HardwareSerial {
+public:
+  LinuxSerial(const char *path);
+  ~LinuxSerial();
+  boolean isOpen(void) { return fd >= 0; }
+  static boolean supportsBaud(uint32_t baud);
+  void begin(uint32_t baud);
+  int available(void);
+  int read(void);
+  size_t write(uint8_t b);
+  size_t write(const uint8_t *buf, size_t len);
+  void flush(void);
+
+private:
+  int fd;
+};
+
+#endif
@@ -0,0 +1,357 @@
+/***************************************************
+  vc0706bench - throughput and latency benchmark for the driver
+
+    vc0706bench [-n frames] [-s size] [-b baud] [-c chunk] [-t hw|sw]
+
+  Runs Adafruit_VC0706 against a simulated camera on a virtual clock, for
+  every combination of image size, baud rate, readPicture() chunk size
+  and transport (or just the ones given on the command line). Bytes go
+  over the simulated wire at the real rate for the baud, so results are
+  what a board would see, but repeatable and without the wait.
+
+  One JSON object per line goes to stdout:
+    fps, bytes_per_s    image throughput, in simulated time
+    link_use            fraction of the raw baud rate carrying image data
+    *_us                average simulated time per driver call
+    cpu_ns_per_byte     host CPU time per byte on the wire: the driver
+                        plus the simulated camera and virtual clock,
+                        whose cost per byte is small and fixed, so
+                        changes in it come from the driver
+
+  BSD license, all text above must be included in any redistribution
+ ****************************************************/
+
+#include "../../Adafruit_VC0706.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <deque>
+#include <vector>
+
+// camera model timing, in us
+#define CMD_LATENCY 1000   // end of a command to the start of the reply
+#define FBUF_DELAY_UNIT 10 // READ_FBUF delay argument is in 0.01 ms
+
+/**************************************************************************/
+/*!
+    @brief Image sizes and typical JPEG sizes at the default compression
+*/
+/**************************************************************************/
+struct ImageSize {
+  const char *name; ///< Resolution
+  uint8_t code;     ///< setImageSize() value
+  uint32_t bytes;   ///< Size of the simulated JPEG
+};
+
+static const ImageSize sizes[] = {
+    {"160x120", VC0706_160x120, 160 * 120 / 6},
+    {"320x240", VC0706_320x240, 320 * 240 / 6},
+    {"640x480", VC0706_640x480, 640 * 480 / 6},
+    {"1024x768", VC0706_1024x768, 1024 * 768 / 6},
+    {"1280x720", VC0706_1280x720, 1280 * 720 / 6},
+    {"1280x960", VC0706_1280x960, 1280 * 960 / 6},
+    {"1920x1080", VC0706_1920x1080, 1920 * 1080 / 6},
+};
+
+static const uint32_t bauds[] = {38400, 57600, 115200};
+// every rate the camera can be set to, for -b
+static const uint32_t cameraBauds[] = {9600, 19200, 38400, 57600, 115200};
+static const uint8_t chunks[] = {32, 64};
+
+/**************************************************************************/
+/*!
+    @brief Build a well-formed JPEG of the given size: SOI, a quantization
+    table, SOS, pseudo-random scan data with FFs stuffed, EOI, then the
+    padding the camera adds after the image
+*/
+/**************************************************************************/
+static std::vector<uint8_t> makeJPEG(uint32_t bytes) {
+  static const uint8_t head[] = {0xFF, 0xD8, 0xFF, 0xDB, 0x00, 0x43, 0x00};
+  static const uint8_t sos[] = {0xFF, 0xDA, 0x00, 0x0C, 0x03, 0x01, 0x00,
+                                0x02, 0x11, 0x03, 0x11, 0x00, 0x3F, 0x00};
+  std::vector<uint8_t> j(head, head + sizeof(head));
+  j.resize(j.size() + 64, 0x10); // quantization table
+  j.insert(j.end(), sos, sos + sizeof(sos));
+
+  uint32_t seed = bytes;
+  while (j.size() < bytes - 2 - 8) {
+    seed = seed * 1103515245 + 12345;
+    uint8_t b = seed >> 16;
+    j.push_back(b);
+    if (b == 0xFF)
+      j.push_back(0x00);
+  }
+  j.push_back(0xFF);
+  j.push_back(0xD9);
+  j.resize(j.size() + 8, 0x00);
+  return j;
+}
+
+/**************************************************************************/
+/*!
+    @brief A VC0706 on the other end of a simulated UART. Bytes take 10 bit
+    times each way. 'hw' transports queue writes like a UART TX buffer,
+    'sw' ones block for each byte like SoftwareSerial.
+*/
+/**************************************************************************/
+class SimCamera : public HardwareSerial {
+public:
+  SimCamera(boolean blockingWrites)
+      : wirebytes(0), blocking(blockingWrites), bytetime(260), txdone(0),
+        rxfree(0), arrived(0) {}
+
+  void begin(uint32_t baud) { bytetime = 10000000 / baud; }
+
+  int available(void) {
+    // bytes arrive in order, so only the ones not yet seen need checking
+    uint64_t now = micros64();
+    while ((arrived < rx.size()) && (rx[arrived].time <= now))
+      arrived++;
+    return arrived;
+  }
+
+  int read(void) {
+    if (!arrived && !available())
+      return -1;
+    uint8_t b = rx.front().data;
+    rx.pop_front();
+    arrived--;
+    return b;
+  }
+
+  using HardwareSerial::write;
+  size_t write(uint8_t b) {
+    uint64_t now = micros64();
+    txdone = ((txdone > now) ? txdone : now) + bytetime;
+    if (blocking)
+      advanceClock(txdone - now);
+    wirebytes++;
+
+    cmd.push_back(b);
+    if ((cmd.size() >= 4) && (cmd.size() == 4u + cmd[3])) {
+      handle();
+      cmd.clear();
+    }
+    return 1;
+  }
+
+  void flush(void) {
+    uint64_t now = micros64();
+    if (txdone > now)
+      advanceClock(txdone - now);
+  }
+
+  std::vector<uint8_t> jpeg; ///< Current frame buffer contents
+  uint64_t wirebytes;        ///< Bytes sent either way
+
+private:
+  struct RxByte {
+    uint64_t time;
+    uint8_t data;
+  };
+
+  void reply(const uint8_t *buf, size_t len, uint64_t start) {
+    if (start > rxfree)
+      rxfree = start;
+    for (size_t i = 0; i < len; i++)
+      send(buf[i]);
+  }
+
+  void send(uint8_t b) {
+    rxfree += bytetime;
+    RxByte r = {rxfree, b};
+    rx.push_back(r);
+    wirebytes++;
+  }
+
+  void handle(void) {
+    uint8_t op = cmd[2];
+    uint8_t ack[] = {0x76, cmd[1], op, 0x00, 0x00};
+    uint64_t t = txdone + CMD_LATENCY;
+
+    if (op == VC0706_GET_FBUF_LEN) {
+      uint32_t l = jpeg.size();
+      uint8_t r[] = {0x76,
+                     cmd[1],
+                     op,
+                     0x00,
+                     0x04,
+                     (uint8_t)(l >> 24),
+                     (uint8_t)(l >> 16),
+                     (uint8_t)(l >> 8),
+                     (uint8_t)l};
+      reply(r, sizeof(r), t);
+    } else if (op == VC0706_READ_FBUF) {
+      uint32_t addr = ((uint32_t)cmd[6] << 24) | ((uint32_t)cmd[7] << 16) |
+                      (cmd[8] << 8) | cmd[9];
+      uint32_t len = ((uint32_t)cmd[10] << 24) | ((uint32_t)cmd[11] << 16) |
+                     (cmd[12] << 8) | cmd[13];
+      uint32_t delay = ((cmd[14] << 8) | cmd[15]) * FBUF_DELAY_UNIT;
+      reply(ack, sizeof(ack), t);
+      rxfree += delay;
+      for (uint32_t i = 0; i < len; i++)
+        send((addr + i < jpeg.size()) ? jpeg[addr + i] : 0);
+      reply(ack, sizeof(ack), rxfree);
+    } else if ((op == VC0706_READ_DATA) || (op == VC0706_DOWNSIZE_STATUS) ||
+               (op == VC0706_COMM_MOTION_STATUS)) {
+      uint8_t r[] = {0x76, cmd[1], op, 0x00, 0x01, 0x00};
+      reply(r, sizeof(r), t);
+    } else {
+      reply(ack, sizeof(ack), t);
+    }
+  }
+
+  boolean blocking;
+  uint32_t bytetime;
+  uint64_t txdone, rxfree; // 64 bits, long runs outlast micros()
+  size_t arrived; // bytes at the front of rx that have reached the driver
+  std::vector<uint8_t> cmd;
+  std::deque<RxByte> rx;
+};
+
+static uint64_t cpuNanos(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void runBench(const ImageSize &size, uint32_t baud, uint8_t chunk,
+                     boolean sw, int frames) {
+  useVirtualClock(true);
+  SimCamera sim(sw);
+  sim.jpeg = makeJPEG(size.bytes);
+  Adafruit_VC0706 cam(&sim);
+  cam.begin(baud);
+  cam.setImageSize(size.code);
+
+  uint64_t take = 0, length = 0, read = 0, resume = 0;
+  unsigned reads = 0, bad = 0;
+  uint64_t image = 0;
+  uint64_t wire = sim.wirebytes;
+  uint64_t start = micros64();
+  uint64_t cpu = cpuNanos();
+
+  for (int f = 0; f < frames; f++) {
+    uint64_t t = micros64();
+    cam.takePicture();
+    take += micros64() - t;
+
+    t = micros64();
+    uint32_t len = cam.frameLength();
+    length += micros64() - t;
+
+    while ((len > 0) && (cam.pictureStatus() == VC0706_JPEG_RUNNING)) {
+      uint8_t n = (len < chunk) ? len : chunk;
+      t = micros64();
+      if (!cam.readPicture(n))
+        break;
+      read += micros64() - t;
+      reads++;
+      image += cam.pictureBytes();
+      len -= n;
+    }
+    bad += cam.pictureStatus() != VC0706_JPEG_COMPLETE;
+
+    t = micros64();
+    cam.resumeVideo();
+    resume += micros64() - t;
+  }
+
+  cpu = cpuNanos() - cpu;
+  double secs = (micros64() - start) / 1e6;
+  wire = sim.wirebytes - wire;
+  useVirtualClock(false);
+
+  printf("{\"size\":\"%s\",\"baud\":%u,\"chunk\":%u,\"transport\":\"%s\","
+         "\"frames\":%d,\"bad_frames\":%u,\"frame_bytes\":%u,"
+         "\"fps\":%.4f,\"bytes_per_s\":%.0f,\"link_use\":%.3f,"
+         "\"take_us\":%.0f,\"length_us\":%.0f,\"read_us\":%.0f,"
+         "\"resume_us\":%.0f,\"cpu_ns_per_byte\":%.1f}\n",
+         size.name, baud, chunk, sw ? "sw" : "hw", frames, bad,
+         (unsigned)size.bytes, frames / secs, image / secs,
+         image / secs * 10 / baud, (double)take / frames,
+         (double)length / frames, reads ? (double)read / reads : 0.0,
+         (double)resume / frames, wire ? (double)cpu / wire : 0.0);
+  fflush(stdout);
+}
+
+static bool knownSize(const char *name) {
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    if (!strcmp(name, sizes[s].name))
+      return true;
+  return false;
+}
+
+static bool cameraBaud(uint32_t baud) {
+  for (size_t i = 0; i < sizeof(cameraBauds) / sizeof(cameraBauds[0]); i++)
+    if (baud == cameraBauds[i])
+      return true;
+  return false;
+}
+
+static void usage(void) {
+  fprintf(stderr, "usage: vc0706bench [-n frames] [-s size] [-b baud] "
+                  "[-c chunk] [-t hw|sw]\n");
+}
+
+int main(int argc, char *argv[]) {
+  int frames = 3;
+  const char *onlySize = NULL, *onlyTransport = NULL;
+  uint32_t onlyBaud = 0;
+  int onlyChunk = 0;
+  bool bad = false; // a value that matches nothing would run nothing
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:s:b:c:t:")) != -1) {
+    switch (opt) {
+    case 'n':
+      frames = atoi(optarg);
+      break;
+    case 's':
+      onlySize = optarg;
+      bad |= !knownSize(onlySize);
+      break;
+    case 'b':
+      onlyBaud = strtoul(optarg, NULL, 0);
+      bad |= !cameraBaud(onlyBaud);
+      break;
+    case 'c':
+      onlyChunk = atoi(optarg);
+      break;
+    case 't':
+      onlyTransport = optarg;
+      bad |= strcmp(onlyTransport, "hw") && strcmp(onlyTransport, "sw");
+      break;
+    default:
+      usage();
+      return 1;
+    }
+  }
+  // readPicture() needs room for 5 more bytes in the driver's buffer
+  if (bad || (optind != argc) || (frames < 1) || (onlyChunk < 0) ||
+      (onlyChunk > CAMERABUFFSIZ - 5)) {
+    usage();
+    return 1;
+  }
+
+  std::vector<uint32_t> b(bauds, bauds + sizeof(bauds) / sizeof(bauds[0]));
+  if (onlyBaud)
+    b.assign(1, onlyBaud);
+  std::vector<uint8_t> c(chunks, chunks + sizeof(chunks));
+  if (onlyChunk)
+    c.assign(1, onlyChunk);
+
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    if (onlySize && strcmp(onlySize, sizes[s].name))
+      continue;
+    for (size_t i = 0; i < b.size(); i++)
+      for (size_t j = 0; j < c.size(); j++)
+        for (int sw = 0; sw < 2; sw++)
+          if (!onlyTransport || !strcmp(onlyTransport, sw ? "sw" : "hw"))
+            runBench(sizes[s], b[i], c[j], sw, frames);
+  }
+  return 0;
+}
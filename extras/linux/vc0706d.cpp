@@ -0,0 +1,450 @@
+/***************************************************
+  vc0706d - capture daemon for VC0706 cameras on Linux hosts
+
+  Continuously captures from one camera and serves, on a loopback port:
+    /            multipart MJPEG stream (same as /stream)
+    /frame.jpg   latest frame
+    /stats       capture and per-stream fps/latency as JSON
+
+  All viewers share the one capture loop, so they no longer fight over
+  the serial port. Frames are handed to client threads by reference;
+  a slow client just gets the newest frame when it is ready again and
+  never holds up capture.
+
+  BSD license, all text above must be included in any redistribution
+ ****************************************************/
+
+#include "../../Adafruit_VC0706.h"
+#include "LinuxSerial.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define CHUNK 64 // READ_FBUF size, must fit in CAMERABUFFSIZ with the header
+#define BOUNDARY "vc0706frame"
+
+static std::atomic<bool> stopping(false);
+
+static uint64_t nowMicros(void) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+/**************************************************************************/
+/*!
+    @brief One captured JPEG, never modified once published
+*/
+/**************************************************************************/
+struct Frame {
+  std::vector<uint8_t> jpeg; ///< Image data
+  uint64_t seq;              ///< Capture sequence number, starts at 1
+  uint64_t trigger;          ///< nowMicros() when the freeze was triggered
+};
+
+typedef std::shared_ptr<const Frame> FramePtr;
+
+/**************************************************************************/
+/*!
+    @brief Exponentially smoothed rate and latency
+*/
+/**************************************************************************/
+struct Meter {
+  uint64_t count = 0; ///< Events seen
+  uint64_t last = 0;  ///< Time of the last event
+  double fps = 0;     ///< Smoothed events per second
+  double latency = 0; ///< Smoothed latency in ms
+
+  void tick(uint64_t now, uint64_t lat) {
+    if (count && (now > last))
+      fps += (1e6 / (now - last) - fps) / 8;
+    latency += (lat / 1000.0 - latency) / (count ? 8 : 1);
+    last = now;
+    count++;
+  }
+};
+
+/**************************************************************************/
+/*!
+    @brief Stats for one connected viewer
+*/
+/**************************************************************************/
+struct StreamStats {
+  unsigned id;         ///< Connection number
+  std::string path;    ///< Requested URL
+  Meter sent;          ///< Frames delivered, latency is trigger to sent
+  uint64_t dropped{0}; ///< Frames skipped because the client was slow
+};
+
+static std::mutex statsLock;
+static Meter captured; // latency is trigger to frame published
+static uint64_t skipped, errors;
+static uint32_t shutterLag; // trigger to ack of the last frame, in us
+static std::list<std::shared_ptr<StreamStats>> streams;
+
+/**************************************************************************/
+/*!
+    @brief Latest-frame mailbox between the capture thread and clients
+*/
+/**************************************************************************/
+class FrameHub {
+public:
+  void publish(FramePtr f) {
+    {
+      std::lock_guard<std::mutex> l(lock);
+      latest = f;
+    }
+    cv.notify_all();
+  }
+
+  // Block until there's a frame newer than seq, null when shutting down
+  FramePtr waitNewer(uint64_t seq) {
+    std::unique_lock<std::mutex> l(lock);
+    cv.wait(l, [&] { return stopping || (latest && (latest->seq > seq)); });
+    return stopping ? FramePtr() : latest;
+  }
+
+  void stop(void) {
+    std::lock_guard<std::mutex> l(lock);
+    cv.notify_all();
+  }
+
+private:
+  std::mutex lock;
+  std::condition_variable cv;
+  FramePtr latest;
+};
+
+static FrameHub hub;
+
+static void captureLoop(Adafruit_VC0706 *cam) {
+  uint64_t seq = 0;
+
+  while (!stopping) {
+    cam->armPicture();
+    uint64_t trigger = nowMicros();
+    if (!cam->triggerPicture()) {
+      cam->resumeVideo();
+      std::lock_guard<std::mutex> l(statsLock);
+      errors++;
+      continue;
+    }
+
+    // a frame the same size as the last one is only a candidate repeat,
+    // it's dropped once the part of the scan the signature covers
+    // (-S) turns out to match too
+    uint32_t len = cam->frameLength();
+    uint32_t remaining = len;
+    bool maybeSame = cam->frameUnchanged(len);
+
+    std::shared_ptr<Frame> f = std::make_shared<Frame>();
+    f->jpeg.reserve(remaining);
+    f->trigger = trigger;
+    while ((remaining > 0) &&
+           (cam->pictureStatus() == VC0706_JPEG_RUNNING)) {
+      uint8_t n = (remaining < CHUNK) ? remaining : CHUNK;
+      uint8_t *buf = cam->readPicture(n);
+      if (!buf)
+        break;
+      f->jpeg.insert(f->jpeg.end(), buf, buf + cam->pictureBytes());
+      remaining -= n;
+      if (maybeSame && cam->scanSignature()) {
+        if (cam->scanUnchanged())
+          break;
+        maybeSame = false;
+      }
+    }
+    cam->resumeVideo();
+
+    if (maybeSame && cam->scanUnchanged()) {
+      std::lock_guard<std::mutex> l(statsLock);
+      skipped++;
+      continue;
+    }
+
+    std::lock_guard<std::mutex> l(statsLock);
+    if (cam->pictureStatus() != VC0706_JPEG_COMPLETE) {
+      errors++;
+      continue;
+    }
+    VC0706_CaptureTiming t = cam->getCaptureTiming();
+    shutterLag = t.ack - t.trigger;
+    f->seq = ++seq;
+    uint64_t now = nowMicros();
+    captured.tick(now, now - trigger);
+    hub.publish(f);
+    cam->keepFrame(len); // only frames that made it out count as seen
+  }
+}
+
+static bool sendAll(int fd, const void *buf, size_t len) {
+  const uint8_t *p = (const uint8_t *)buf;
+  while (len > 0) {
+    ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+    if (n <= 0)
+      return false;
+    p += n;
+    len -= n;
+  }
+  return true;
+}
+
+static bool sendAll(int fd, const std::string &s) {
+  return sendAll(fd, s.data(), s.size());
+}
+
+static std::string statsJson(void) {
+  std::lock_guard<std::mutex> l(statsLock);
+  char buf[256];
+  snprintf(buf, sizeof(buf),
+           "{\"capture\":{\"frames\":%llu,\"fps\":%.2f,\"latency_ms\":%.1f,"
+           "\"shutter_lag_us\":%u,\"skipped\":%llu,\"errors\":%llu},"
+           "\"streams\":[",
+           (unsigned long long)captured.count, captured.fps, captured.latency,
+           shutterLag, (unsigned long long)skipped,
+           (unsigned long long)errors);
+  std::string s = buf;
+  for (auto it = streams.begin(); it != streams.end(); ++it) {
+    const StreamStats &st = **it;
+    snprintf(buf, sizeof(buf),
+             "%s{\"id\":%u,\"path\":\"%s\",\"frames\":%llu,\"fps\":%.2f,"
+             "\"latency_ms\":%.1f,\"dropped\":%llu}",
+             (it == streams.begin()) ? "" : ",", st.id, st.path.c_str(),
+             (unsigned long long)st.sent.count, st.sent.fps, st.sent.latency,
+             (unsigned long long)st.dropped);
+    s += buf;
+  }
+  return s + "]}\n";
+}
+
+static void serveStream(int fd, StreamStats *st) {
+  if (!sendAll(fd, "HTTP/1.0 200 OK\r\nCache-Control: no-cache\r\n"
+                   "Content-Type: multipart/x-mixed-replace; boundary=" BOUNDARY
+                   "\r\n\r\n"))
+    return;
+
+  uint64_t seq = 0;
+  while (FramePtr f = hub.waitNewer(seq)) {
+    char hdr[128];
+    snprintf(hdr, sizeof(hdr),
+             "--" BOUNDARY "\r\nContent-Type: image/jpeg\r\n"
+             "Content-Length: %zu\r\n\r\n",
+             f->jpeg.size());
+    if (!sendAll(fd, hdr, strlen(hdr)) ||
+        !sendAll(fd, f->jpeg.data(), f->jpeg.size()) || !sendAll(fd, "\r\n"))
+      return;
+
+    std::lock_guard<std::mutex> l(statsLock);
+    if (seq)
+      st->dropped += f->seq - seq - 1;
+    uint64_t now = nowMicros();
+    st->sent.tick(now, now - f->trigger);
+    seq = f->seq;
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief A connection and the thread serving it. The main thread owns the
+    socket: it closes it after joining, and shuts it down to wake the
+    thread up when the daemon exits.
+*/
+/**************************************************************************/
+struct Client {
+  int fd;                        ///< Connected socket
+  unsigned id;                   ///< Connection number
+  std::thread thread;            ///< Runs serveClient()
+  std::atomic<bool> done{false}; ///< Set once serveClient() returns
+};
+
+static void serveClient(Client *c) {
+  int fd = c->fd;
+  char req[1024] = "";
+  size_t len = 0;
+  while ((len < sizeof(req) - 1) && !strstr(req, "\r\n\r\n")) {
+    ssize_t n = recv(fd, req + len, sizeof(req) - 1 - len, 0);
+    if (n <= 0)
+      break;
+    len += n;
+    req[len] = 0;
+  }
+  req[len] = 0;
+
+  char path[256] = "";
+  if (sscanf(req, "GET %255s", path) != 1) {
+    sendAll(fd, "HTTP/1.0 400 Bad Request\r\n\r\n");
+  } else if (!strcmp(path, "/stats")) {
+    std::string body = statsJson();
+    sendAll(fd, "HTTP/1.0 200 OK\r\nContent-Type: application/json\r\n"
+                "Content-Length: " +
+                    std::to_string(body.size()) + "\r\n\r\n" + body);
+  } else if (!strcmp(path, "/frame.jpg")) {
+    if (FramePtr f = hub.waitNewer(0)) {
+      std::string hdr = "HTTP/1.0 200 OK\r\nContent-Type: image/jpeg\r\n"
+                        "Content-Length: " +
+                        std::to_string(f->jpeg.size()) + "\r\n\r\n";
+      if (sendAll(fd, hdr))
+        sendAll(fd, f->jpeg.data(), f->jpeg.size());
+    }
+  } else if (!strcmp(path, "/") || !strcmp(path, "/stream")) {
+    std::shared_ptr<StreamStats> st = std::make_shared<StreamStats>();
+    st->id = c->id;
+    st->path = path;
+    {
+      std::lock_guard<std::mutex> l(statsLock);
+      streams.push_back(st);
+    }
+    serveStream(fd, st.get());
+    std::lock_guard<std::mutex> l(statsLock);
+    streams.remove(st);
+  } else {
+    sendAll(fd, "HTTP/1.0 404 Not Found\r\n\r\n");
+  }
+  c->done = true;
+}
+
+// Join and close finished connections, or all of them when exiting
+static void reapClients(std::list<std::unique_ptr<Client>> &clients,
+                        bool all) {
+  for (auto it = clients.begin(); it != clients.end();) {
+    Client &c = **it;
+    if (!all && !c.done) {
+      ++it;
+      continue;
+    }
+    if (all)
+      shutdown(c.fd, SHUT_RDWR); // wakes up recv()/send()
+    c.thread.join();
+    close(c.fd);
+    it = clients.erase(it);
+  }
+}
+
+static void onSignal(int) { stopping = true; }
+
+static void usage(const char *argv0) {
+  fprintf(stderr,
+          "usage: %s [-d device] [-b baud] [-p port] [-s permille] "
+          "[-S bytes]\n"
+          "  -d  camera tty (default /dev/ttyAMA0)\n"
+          "  -b  baud rate the camera is currently set to (default 38400)\n"
+          "  -p  loopback HTTP port (default 8080)\n"
+          "  -s  skip frames within this many permille of the last size\n"
+          "      whose first -S bytes of scan data are also identical\n"
+          "  -S  scan bytes -s compares (default %d, 0 for the whole\n"
+          "      image); the default only covers the top-left corner\n",
+          argv0, VC0706_SIGBYTES);
+}
+
+int main(int argc, char *argv[]) {
+  const char *device = "/dev/ttyAMA0";
+  uint32_t baud = 38400;
+  int port = 8080;
+  int similarity = 0;
+  long sigbytes = VC0706_SIGBYTES;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "d:b:p:s:S:h")) != -1) {
+    switch (opt) {
+    case 'd':
+      device = optarg;
+      break;
+    case 'b':
+      baud = strtoul(optarg, NULL, 0);
+      break;
+    case 'p':
+      port = atoi(optarg);
+      break;
+    case 's':
+      similarity = atoi(optarg);
+      break;
+    case 'S':
+      sigbytes = atol(optarg);
+      break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (sigbytes < 0) {
+    usage(argv[0]);
+    return 1;
+  }
+  if (!LinuxSerial::supportsBaud(baud)) {
+    fprintf(stderr, "Unsupported baud rate %u\n", (unsigned)baud);
+    return 1;
+  }
+
+  LinuxSerial serial(device);
+  if (!serial.isOpen()) {
+    perror(device);
+    return 1;
+  }
+  Adafruit_VC0706 cam(&serial);
+  if (!cam.begin(baud)) {
+    fprintf(stderr, "No camera found on %s at %u baud\n", device,
+            (unsigned)baud);
+    return 1;
+  }
+  cam.setFrameSimilarity(similarity);
+  cam.setScanSignatureBytes(sigbytes);
+
+  int srv = socket(AF_INET, SOCK_STREAM, 0);
+  int one = 1;
+  setsockopt(srv, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if ((bind(srv, (struct sockaddr *)&addr, sizeof(addr)) != 0) ||
+      (listen(srv, 8) != 0)) {
+    perror("bind");
+    return 1;
+  }
+  fprintf(stderr, "Serving %s on http://127.0.0.1:%d/\n", device, port);
+
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+  std::thread capture(captureLoop, &cam);
+
+  std::list<std::unique_ptr<Client>> clients;
+  unsigned id = 0;
+  while (!stopping) {
+    reapClients(clients, false);
+    struct pollfd pfd = {srv, POLLIN, 0};
+    if (poll(&pfd, 1, 500) <= 0)
+      continue;
+    int fd = accept(srv, NULL, NULL);
+    if (fd < 0)
+      continue;
+    Client *c = new Client;
+    c->fd = fd;
+    c->id = ++id;
+    clients.emplace_back(c);
+    c->thread = std::thread(serveClient, c);
+  }
+
+  hub.stop();
+  capture.join();
+  reapClients(clients, true);
+  close(srv);
+  return 0;
+}
@@ -0,0 +1,363 @@
+/***************************************************
+  vc0706trace - record, inspect and replay VC0706 wire traces
+
+    vc0706trace record [-d device] [-b baud] [-c chunk] [-n frames] out.bin
+    vc0706trace dump trace.bin
+    vc0706trace replay [-c chunk] [-n frames] trace.bin
+
+  'record' runs a snapshot session (reset, then takePicture, frameLength,
+  readPicture until the end of the image and resumeVideo for each frame)
+  against a real camera with Adafruit_VC0706::setTrace() enabled and
+  saves the trace.
+
+  'replay' only works on a trace of exactly that session: it must start
+  with the reset from begin(), so a ring buffer that wrapped can't be
+  replayed, and -c and -n have to match the recording. Traces saved on
+  a microcontroller with dumpTrace() qualify if the sketch followed the
+  same steps with a big enough buffer.
+
+  'replay' runs the same session against the recorded bytes instead of a
+  camera. Camera replies are held back until as long after the driver's
+  request as they took in the recording, so timing problems seen in the
+  field can be reproduced and profiled with no camera attached.
+
+  BSD license, all text above must be included in any redistribution
+ ****************************************************/
+
+#include "../../Adafruit_VC0706.h"
+#include "LinuxSerial.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <deque>
+#include <vector>
+
+#define MAXTRACE (1 << 22) // records kept by 'record'
+
+/**************************************************************************/
+/*!
+    @brief Print that writes to a stdio file
+*/
+/**************************************************************************/
+class FilePrint : public Print {
+public:
+  FilePrint(FILE *f) : fp(f) {}
+  using Print::write;
+  size_t write(uint8_t b) { return fwrite(&b, 1, 1, fp); }
+  size_t write(const uint8_t *buf, size_t len) {
+    return fwrite(buf, 1, len, fp);
+  }
+
+private:
+  FILE *fp;
+};
+
+/**************************************************************************/
+/*!
+    @brief Plays back the camera's side of a trace. Every byte the driver
+    writes is checked against the recording and re-anchors the clock, so
+    the replies that follow arrive with their recorded delays.
+*/
+/**************************************************************************/
+class ReplaySerial : public HardwareSerial {
+public:
+  ReplaySerial(const std::vector<VC0706_TraceRecord> &t)
+      : mismatches(0), firstMismatch(0), trace(t), pos(0), anchor(0) {
+    if (!trace.empty())
+      anchor = micros() - trace[0].time;
+  }
+
+  void begin(uint32_t) {}
+
+  int available(void) {
+    release();
+    return pending.size();
+  }
+
+  int read(void) {
+    release();
+    if (pending.empty())
+      return -1;
+    uint8_t b = pending.front();
+    pending.pop_front();
+    return b;
+  }
+
+  using HardwareSerial::write;
+  size_t write(uint8_t b) {
+    // the camera sent these before this point in the recording, so by
+    // now they'd be sitting in the UART waiting to be read
+    while ((pos < trace.size()) && (trace[pos].dir == VC0706_TRACE_RX))
+      pending.push_back(trace[pos++].data);
+
+    if ((pos == trace.size()) || (trace[pos].data != b)) {
+      if (!mismatches++)
+        firstMismatch = pos;
+    } else {
+      anchor = micros() - trace[pos].time;
+    }
+    if (pos < trace.size())
+      pos++;
+    return 1;
+  }
+
+  size_t remaining(void) { return trace.size() - pos; }
+  size_t mismatches;    ///< Bytes written that differ from the trace
+  size_t firstMismatch; ///< Trace position of the first of them
+
+private:
+  void release(void) {
+    while ((pos < trace.size()) && (trace[pos].dir == VC0706_TRACE_RX) &&
+           ((int32_t)(micros() - anchor - trace[pos].time) >= 0))
+      pending.push_back(trace[pos++].data);
+  }
+
+  const std::vector<VC0706_TraceRecord> &trace;
+  size_t pos;
+  uint32_t anchor;
+  std::deque<uint8_t> pending;
+};
+
+/**************************************************************************/
+/*!
+    @brief Running total for one kind of driver call
+*/
+/**************************************************************************/
+struct CallStats {
+  const char *name; ///< Driver call
+  unsigned calls;   ///< Times called
+  unsigned fails;   ///< Times it returned failure
+  uint32_t total;   ///< Time spent in it, in us
+  uint32_t worst;   ///< Slowest call, in us
+};
+
+enum { BEGIN, TAKE, LENGTH, READ, RESUME, NCALLS };
+
+static CallStats calls[NCALLS] = {{"begin", 0, 0, 0, 0},
+                                  {"takePicture", 0, 0, 0, 0},
+                                  {"frameLength", 0, 0, 0, 0},
+                                  {"readPicture", 0, 0, 0, 0},
+                                  {"resumeVideo", 0, 0, 0, 0}};
+
+static void account(int call, uint32_t start, bool ok) {
+  uint32_t t = micros() - start;
+  calls[call].calls++;
+  calls[call].fails += !ok;
+  calls[call].total += t;
+  if (t > calls[call].worst)
+    calls[call].worst = t;
+}
+
+static void runSession(Adafruit_VC0706 &cam, uint32_t baud, uint8_t chunk,
+                       int frames) {
+  uint32_t t = micros();
+  bool ok = cam.begin(baud);
+  account(BEGIN, t, ok);
+  if (!ok)
+    return;
+
+  for (int f = 0; f < frames; f++) {
+    t = micros();
+    account(TAKE, t, cam.takePicture());
+
+    t = micros();
+    uint32_t len = cam.frameLength();
+    account(LENGTH, t, len != 0);
+
+    while ((len > 0) && (cam.pictureStatus() == VC0706_JPEG_RUNNING)) {
+      uint8_t n = (len < chunk) ? len : chunk;
+      t = micros();
+      ok = cam.readPicture(n) != NULL;
+      account(READ, t, ok);
+      if (!ok)
+        break;
+      len -= n;
+    }
+
+    t = micros();
+    account(RESUME, t, cam.resumeVideo());
+  }
+}
+
+static void printCalls(uint32_t elapsed) {
+  printf("%-12s %7s %6s %10s %10s %10s\n", "call", "count", "fails",
+         "total ms", "avg us", "worst us");
+  for (int i = 0; i < NCALLS; i++) {
+    if (!calls[i].calls)
+      continue;
+    printf("%-12s %7u %6u %10.1f %10u %10u\n", calls[i].name, calls[i].calls,
+           calls[i].fails, calls[i].total / 1000.0,
+           calls[i].total / calls[i].calls, calls[i].worst);
+  }
+  printf("session took %.1f ms\n", elapsed / 1000.0);
+}
+
+static bool loadTrace(const char *path, std::vector<VC0706_TraceRecord> &t) {
+  FILE *fp = fopen(path, "rb");
+  if (!fp) {
+    perror(path);
+    return false;
+  }
+  uint8_t rec[6];
+  if ((fread(rec, 1, 4, fp) != 4) || memcmp(rec, "VCT1", 4)) {
+    fprintf(stderr, "%s: not a VC0706 trace\n", path);
+    fclose(fp);
+    return false;
+  }
+  while (fread(rec, 1, sizeof(rec), fp) == sizeof(rec)) {
+    VC0706_TraceRecord r;
+    r.time = rec[3];
+    r.time = (r.time << 8) | rec[2];
+    r.time = (r.time << 8) | rec[1];
+    r.time = (r.time << 8) | rec[0];
+    r.dir = rec[4];
+    r.data = rec[5];
+    t.push_back(r);
+  }
+  fclose(fp);
+  return true;
+}
+
+static int dump(const std::vector<VC0706_TraceRecord> &t) {
+  // one line per run of bytes in the same direction
+  for (size_t i = 0; i < t.size();) {
+    size_t j = i;
+    printf("%10.3f ms %s", (uint32_t)(t[i].time - t[0].time) / 1000.0,
+           (t[i].dir == VC0706_TRACE_TX) ? "TX" : "RX");
+    while ((j < t.size()) && (t[j].dir == t[i].dir)) {
+      if (j - i < 16)
+        printf(" %02X", t[j].data);
+      j++;
+    }
+    if (j - i > 16)
+      printf(" ... (%u bytes)", (unsigned)(j - i));
+    printf("\n");
+    i = j;
+  }
+  return 0;
+}
+
+static void usage(void) {
+  fprintf(stderr,
+          "usage: vc0706trace record [-d device] [-b baud] [-c chunk] "
+          "[-n frames] out.bin\n"
+          "       vc0706trace dump trace.bin\n"
+          "       vc0706trace replay [-c chunk] [-n frames] trace.bin\n");
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    usage();
+    return 1;
+  }
+  const char *mode = argv[1];
+  const char *device = "/dev/ttyAMA0";
+  uint32_t baud = 38400;
+  int chunk = 32, frames = 1;
+
+  int opt;
+  optind = 2;
+  while ((opt = getopt(argc, argv, "d:b:c:n:")) != -1) {
+    switch (opt) {
+    case 'd':
+      device = optarg;
+      break;
+    case 'b':
+      baud = strtoul(optarg, NULL, 0);
+      break;
+    case 'c':
+      chunk = atoi(optarg);
+      break;
+    case 'n':
+      frames = atoi(optarg);
+      break;
+    default:
+      usage();
+      return 1;
+    }
+  }
+  if ((optind != argc - 1) || (chunk < 1) ||
+      (chunk > CAMERABUFFSIZ - 5)) { // readPicture() needs room for 5 more
+    usage();
+    return 1;
+  }
+  const char *path = argv[optind];
+
+  if (!strcmp(mode, "record")) {
+    if (!LinuxSerial::supportsBaud(baud)) {
+      fprintf(stderr, "Unsupported baud rate %u\n", (unsigned)baud);
+      return 1;
+    }
+    LinuxSerial serial(device);
+    if (!serial.isOpen()) {
+      perror(device);
+      return 1;
+    }
+    std::vector<VC0706_TraceRecord> buf(MAXTRACE);
+    Adafruit_VC0706 cam(&serial);
+    cam.setTrace(buf.data(), buf.size());
+
+    uint32_t t = micros();
+    runSession(cam, baud, chunk, frames);
+    printCalls(micros() - t);
+
+    FILE *fp = fopen(path, "wb");
+    if (!fp) {
+      perror(path);
+      return 1;
+    }
+    FilePrint out(fp);
+    printf("%u records written to %s\n", (unsigned)cam.dumpTrace(out), path);
+    fclose(fp);
+    return 0;
+  }
+
+  std::vector<VC0706_TraceRecord> trace;
+  if (!loadTrace(path, trace))
+    return 1;
+
+  if (!strcmp(mode, "dump"))
+    return dump(trace);
+
+  if (!strcmp(mode, "replay")) {
+    // the session starts with begin(), whose first command is a reset
+    size_t first = 0;
+    while ((first < trace.size()) && (trace[first].dir != VC0706_TRACE_TX))
+      first++;
+    if ((trace.size() < first + 3) || (trace[first].data != 0x56) ||
+        (trace[first + 2].data != VC0706_RESET)) {
+      fprintf(stderr,
+              "%s doesn't start with a camera reset, so it can't be "
+              "replayed\n(did the trace buffer wrap?)\n",
+              path);
+      return 1;
+    }
+
+    ReplaySerial serial(trace);
+    Adafruit_VC0706 cam(&serial);
+
+    uint32_t t = micros();
+    runSession(cam, baud, chunk, frames);
+    printCalls(micros() - t);
+    if (!trace.empty())
+      printf("recording took %.1f ms\n",
+             (trace.back().time - trace.front().time) / 1000.0);
+    printf("%u bytes sent that don't match the trace, %u records unused\n",
+           (unsigned)serial.mismatches, (unsigned)serial.remaining());
+    if (serial.mismatches && (serial.firstMismatch == trace.size()))
+      printf("first mismatch past the end of the trace; "
+             "check -c and -n match it\n");
+    else if (serial.mismatches)
+      printf("first mismatch at record %u, %.1f ms into the recording; "
+             "check -c and -n match it\n",
+             (unsigned)serial.firstMismatch,
+             (trace[serial.firstMismatch].time - trace.front().time) /
+                 1000.0);
+    return serial.mismatches ? 2 : 0;
+  }
+
+  usage();
+  return 1;
+}
@@ -3,6 +3,7 @@
 # written by ladyada. MIT license
 
 import serial
+import sys
 
 BAUD = 38400
 PORT = "COM1"      # change this to your com port!
@@ -84,29 +85,104 @@ def getbufferlength():
 readphotocommand = [COMMANDSEND, SERIALNUM, CMD_READBUFF, 0x0c, FBUF_CURRENTFRAME, 0x0a]
 
 
+# walks the JPEG marker structure a chunk at a time so the transfer can
+# stop at the end of image marker instead of reading the camera's padding
+JPEG_RUNNING = 0
+JPEG_COMPLETE = 1
+JPEG_CORRUPT = 2
+
+class jpegparser:
+    def __init__(self):
+        self.state = 'soi'
+        self.status = JPEG_RUNNING
+        self.skip = 0
+        self.sos = False
+
+    # returns how many bytes of the chunk are image data
+    def feed(self, chunk):
+        for i in range(len(chunk)):
+            if self.status != JPEG_RUNNING:
+                break
+            b = ord(chunk[i])
+            if self.state == 'soi':
+                if b != 0xFF:
+                    self.status = JPEG_CORRUPT
+                self.state = 'soi2'
+            elif self.state == 'soi2':
+                if b != 0xD8:
+                    self.status = JPEG_CORRUPT
+                self.state = 'marker'
+            elif self.state == 'marker':
+                if b != 0xFF:
+                    self.status = JPEG_CORRUPT
+                self.state = 'markerid'
+            elif self.state == 'entropy':
+                if b == 0xFF:
+                    self.state = 'entropyff'
+            elif (self.state == 'entropyff' and
+                  (b == 0x00 or (b >= 0xD0 and b <= 0xD7))):
+                self.state = 'entropy'    # stuffed FF or restart marker
+            elif self.state in ('markerid', 'entropyff'):
+                if b == 0xFF:             # fill byte
+                    self.state = 'markerid'
+                elif b == 0xD9:
+                    self.status = JPEG_COMPLETE
+                    return i + 1
+                else:
+                    self.sos = (b == 0xDA)
+                    self.state = 'len'
+            elif self.state == 'len':
+                self.skip = b << 8
+                self.state = 'len2'
+            elif self.state == 'len2':
+                self.skip += b
+                if self.skip < 2:
+                    self.status = JPEG_CORRUPT
+                self.skip -= 2            # the length includes itself
+                self.state = 'skip'
+            elif self.state == 'skip':
+                self.skip -= 1
+            if self.state == 'skip' and self.skip <= 0:
+                if self.sos:
+                    self.state = 'entropy'
+                else:
+                    self.state = 'marker'
+        return len(chunk)
+
 def readbuffer(bytes):
     addr = 0
     photo = []
+    jpeg = jpegparser()
     
-    while (addr < bytes + 32):
+    while (addr < bytes):
+        n = min(32, bytes - addr)   # 32 bytes at a time
         command = readphotocommand + [(addr >> 24) & 0xFF, (addr >> 16) & 0xFF,
                                       (addr >> 8) & 0xFF, addr & 0xFF]
-        command +=  [0, 0, 0, 32]   # 32 bytes at a time
+        command +=  [0, 0, 0, n]
         command +=  [1,0]         # delay of 10ms
         #print map(hex, command)
         cmd = ''.join(map (chr, command))
         s.write(cmd)
-        reply = s.read(32+5)
+        # the data comes with an ack before and after it
+        reply = s.read(5+n+5)
         r = list(reply)
-        if (len(r) != 37):
+        if (len(r) != 5+n+5):
             continue
         #print r
-        if (not checkreply(r, CMD_READBUFF)):
+        if (not checkreply(r, CMD_READBUFF) or
+            not checkreply(r[5+n:], CMD_READBUFF)):
             print "ERROR READING PHOTO"
             return
-        photo += r[5:]
-        addr += 32
-    return photo
+        chunk = r[5:5+n]
+        photo += chunk[:jpeg.feed(chunk)]
+        addr += n
+        if jpeg.status == JPEG_CORRUPT:
+            print "ERROR: PHOTO IS NOT A VALID JPEG"
+            return
+        if jpeg.status == JPEG_COMPLETE:
+            return photo
+    print "ERROR: PHOTO ENDED WITHOUT AN END OF IMAGE MARKER"
+    return
     
 
 
@@ -131,6 +207,9 @@ print bytes, "bytes to read"
 
 photo = readbuffer(bytes)
 #photo = readbuffer(5024)
+if photo is None:
+    print "Not saving photo.jpg"
+    sys.exit(1)
 
 f = open("photo.jpg", 'w')
 #print photo